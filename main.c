@@ -3,9 +3,14 @@
 #include <string.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <time.h>
+#include <sys/select.h>
 #include <sys/wait.h>
 #include <X11/X.h>
 #include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/Xatom.h>
+#include <X11/Xproto.h>
 #include <X11/keysym.h>
 #include <X11/XKBlib.h>
 #include <X11/cursorfont.h>
@@ -20,6 +25,7 @@
 #define KEY_UP       XK_k
 #define KEY_RIGHT    XK_l
 #define KEY_MAXIMIZE XK_x
+#define KEY_SEARCH   XK_slash
 
 #define BUTTON_LEFT  1
 #define BUTTON_RIGHT 3
@@ -27,20 +33,66 @@
 #define SHELL_NAME "/bin/sh"
 
 #define LINE_SIZE 1024
+#define TITLE_SIZE 256
+#define PICKER_WIDTH   480
+#define PICKER_LINES   10
+#define PICKER_PADDING 4
 #define DEFAULT_MODMASK Mod1Mask
 #define DEFAULT_TERM    "xterm"
+#define DEFAULT_FRAME_POOL 8
+#define DEFAULT_FOCUS_DELAY 50
+
+#define FOCUS_MOUSE 0
+#define FOCUS_CLICK 1
+
+#define NET_WM_STATE_REMOVE 0
+#define NET_WM_STATE_ADD    1
+#define NET_WM_STATE_TOGGLE 2
+#define NET_WM_STATE_MAX    32
 
 #define MouseMask (ButtonPressMask|ButtonReleaseMask|PointerMotionMask)
 #define ChildMask (SubstructureRedirectMask|SubstructureNotifyMask)
 
 #define max(a, b) ((a) > (b))? (a) : (b)
 
+// Build with -DPSWM_TRACE to count the requests and round trips every handler
+// sends and abort as soon as one goes over the budget given to TRACE. Both come
+// from sequence numbers on the connection, so no blocking call can slip past.
+#ifdef PSWM_TRACE
+unsigned long trace_request = 0;
+int trace_round_trips = 0;
+int trace_after(Display *);
+void trace_check(const char *, unsigned long, int, unsigned long, int);
+
+#define TRACE(state, action, max_requests, max_round_trips, call) do { \
+        trace_after((state)->dpy); \
+        unsigned long trace_start = NextRequest((state)->dpy); \
+        int trace_round_trip = trace_round_trips; \
+        call; \
+        trace_after((state)->dpy); \
+        trace_check(action, NextRequest((state)->dpy) - trace_start, \
+                    trace_round_trips - trace_round_trip, max_requests, max_round_trips); \
+    } while (0)
+#else
+#define TRACE(state, action, max_requests, max_round_trips, call) call
+#endif
+
 typedef struct _PSWMClient {
     Window parent;
     Window window;
     XWindowAttributes init_attr;
     XWindowAttributes attr;
     int maximized;
+    int fullscreen;
+    int ignore_unmap;
+    unsigned long focus_stamp;
+
+    // Search index, filled the first time a picker opens and refreshed on PropertyNotify
+    int indexed;
+    char title[TITLE_SIZE];
+    char instance[TITLE_SIZE];
+    char class[TITLE_SIZE];
+    char search[3*TITLE_SIZE];
 
     struct _PSWMClient *next;
 } PSWMClient;
@@ -52,6 +104,11 @@ typedef struct PSWMConfig {
 
     int modmask;
     char *terminal;
+    char **fullscreen_classes;
+    int fullscreen_count;
+    int frame_pool_max;
+    int focus_policy;
+    int focus_delay;
 } PSWMConfig;
 
 typedef struct PSWMState {
@@ -62,14 +119,34 @@ typedef struct PSWMState {
     int exit;
     int has_randr;
     int randr_base;
+    int has_randr_monitors;
+    Atom net_supported;
+    Atom net_supporting_wm_check;
+    Atom net_wm_name;
+    Atom utf8_string;
+    Atom net_wm_state;
+    Atom net_wm_state_fullscreen;
+    Window wm_check;
 
     PSWMConfig config;
     PSWMClient *current_client;
     ClientList clients;
+    Window *frame_pool;
+    int frame_pool_count;
+    Window focused;
+    unsigned long focus_counter;
+    Window pending_focus;
+    long pending_focus_deadline;
     Cursor cursor_drag;
     Cursor cursor_resize;
+    Window picker;
+    GC picker_gc;
 } PSWMState;
 
+// Serial of the ReparentWindow handle_unmap sends for a withdrawn client, the
+// error handler has no PSWMState to look it up in
+unsigned long withdraw_reparent_serial = 0;
+
 PSWMClient *client_make_from_client(PSWMClient *);
 
 ClientList clientlist_new(void);
@@ -78,6 +155,13 @@ ClientList clientlist_append(ClientList, PSWMClient *);
 ClientList clientlist_delete(ClientList, PSWMClient *);
 PSWMClient *init_client(PSWMState *, Window);
 PSWMClient *find_client(PSWMState *, Window);
+Window create_frame(PSWMState *, XWindowAttributes *);
+Window acquire_frame(PSWMState *, XWindowAttributes *);
+void release_frame(PSWMState *, Window);
+int wants_fullscreen(PSWMState *, PSWMClient *);
+void update_client_title(PSWMState *, PSWMClient *);
+void update_client_class(PSWMState *, PSWMClient *);
+void update_client_search(PSWMClient *);
 
 int numeric_string(char *);
 
@@ -90,6 +174,8 @@ char *parse_term(char *);
 void grab_keys(PSWMState *);
 void grab_buttons(PSWMState *);
 void event_main_loop(PSWMState *);
+long now_ms(void);
+int wait_for_event(PSWMState *);
 
 int handle_xerror(Display *, XErrorEvent *);
 void handle_key_press(PSWMState *, XKeyEvent *);
@@ -98,15 +184,36 @@ void handle_configure_request(PSWMState *, XConfigureRequestEvent *);
 void handle_map_request(PSWMState *, XMapRequestEvent *);
 void handle_unmap(PSWMState *, XUnmapEvent *);
 void handle_enter(PSWMState *, XCrossingEvent *);
+void handle_click_focus(PSWMState *, XButtonEvent *);
+void handle_focus(PSWMState *, XFocusChangeEvent *);
+void handle_client_message(PSWMState *, XClientMessageEvent *);
+void handle_property(PSWMState *, XPropertyEvent *);
 
 void spawn(PSWMState *, const char *);
-void next_client(PSWMState *);
+void activate_client(PSWMState *, PSWMClient *);
+void focus_client(PSWMState *, PSWMClient *);
+void commit_pending_focus(PSWMState *);
 void move_window(PSWMState *, KeySym, XKeyEvent *);
 void maximize_window(PSWMState *, XKeyEvent *);
+void monitor_geometry(PSWMState *, PSWMClient *, int *, int *, int *, int *);
+void set_fullscreen(PSWMState *, PSWMClient *, int);
+void update_net_wm_state(PSWMState *, PSWMClient *, int);
+void frame_client(PSWMState *, PSWMClient *);
+void unframe_client(PSWMState *, PSWMClient *);
 
 void drag_window(PSWMState *, XButtonEvent *);
 void resize_window(PSWMState *, XButtonEvent *);
 
+PSWMClient **clients_by_mru(PSWMState *, int *);
+void index_client(PSWMState *, PSWMClient *);
+int compare_mru(const void *, const void *);
+int match_clients(PSWMClient **, int, const char *, PSWMClient **);
+void show_picker(PSWMState *, int);
+void draw_picker(PSWMState *, const char *, PSWMClient **, int, int);
+void close_picker(PSWMState *, PSWMClient *);
+void switch_clients(PSWMState *);
+void search_clients(PSWMState *);
+
 int main(int argc, char **argv)
 {
     int display_number = 0;
@@ -132,7 +239,12 @@ int main(int argc, char **argv)
 
     free(state.config.terminal);
     free(state.config.path);
+    for (int i = 0; i < state.config.fullscreen_count; ++i)
+        free(state.config.fullscreen_classes[i]);
+    free(state.config.fullscreen_classes);
+    free(state.frame_pool);
     clientlist_free(state.clients);
+    XDestroyWindow(state.dpy, state.wm_check);
     XCloseDisplay(state.dpy);
     return 0;
 }
@@ -146,6 +258,14 @@ PSWMClient *client_make_from_client(PSWMClient *client)
     c->init_attr = client->init_attr;
     c->attr = client->attr;
     c->maximized = client->maximized;
+    c->fullscreen = client->fullscreen;
+    c->ignore_unmap = client->ignore_unmap;
+    c->focus_stamp = client->focus_stamp;
+    c->indexed = client->indexed;
+    strcpy(c->title, client->title);
+    strcpy(c->instance, client->instance);
+    strcpy(c->class, client->class);
+    strcpy(c->search, client->search);
 
     return c;
 }
@@ -225,21 +345,151 @@ PSWMClient *init_client(PSWMState *state, Window w)
 
     c->window = w;
     c->maximized = 0;
+    c->ignore_unmap = 0;
+    c->focus_stamp = 0;
     XGetWindowAttributes(state->dpy, c->window, &c->init_attr);
-    XGetWindowAttributes(state->dpy, c->window, &c->attr);
+    c->attr = c->init_attr;
+
+    XSelectInput(state->dpy, c->window, EnterWindowMask | FocusChangeMask | PropertyChangeMask);
+
+    // Titles are only needed by the pickers, keep their round trips off the map path
+    c->indexed = 0;
+    c->title[0] = '\0';
+    c->instance[0] = '\0';
+    c->class[0] = '\0';
+    c->search[0] = '\0';
 
-    XSelectInput(state->dpy, c->window, EnterWindowMask);
+    // Fullscreen windows skip the frame entirely, one is created if they leave fullscreen
+    c->fullscreen = wants_fullscreen(state, c);
+    c->parent = c->fullscreen? None : acquire_frame(state, &c->init_attr);
+    return c;
+}
 
+Window create_frame(PSWMState *state, XWindowAttributes *geometry)
+{
     XSetWindowAttributes attr;
     attr.override_redirect = True;
     attr.event_mask = ChildMask | ButtonPressMask | KeyPressMask | EnterWindowMask;
 
-    c->parent = XCreateWindow(state->dpy, state->root, c->init_attr.x, c->init_attr.y,
-                              c->init_attr.width, c->init_attr.height, 0,
-                              XDefaultDepth(state->dpy, 0), CopyFromParent,
-                              XDefaultVisual(state->dpy, 0),
-                              CWOverrideRedirect | CWBorderPixel | CWEventMask, &attr);
-    return c;
+    Window frame = XCreateWindow(state->dpy, state->root, geometry->x, geometry->y,
+                                 geometry->width, geometry->height, 0,
+                                 XDefaultDepth(state->dpy, 0), CopyFromParent,
+                                 XDefaultVisual(state->dpy, 0),
+                                 CWOverrideRedirect | CWBorderPixel | CWEventMask, &attr);
+
+    // Clicks are held until handle_click_focus focuses the client and replays them
+    if (state->config.focus_policy == FOCUS_CLICK)
+        XGrabButton(state->dpy, AnyButton, AnyModifier, frame, False, ButtonPressMask,
+                    GrabModeSync, GrabModeAsync, None, None);
+
+    return frame;
+}
+
+Window acquire_frame(PSWMState *state, XWindowAttributes *geometry)
+{
+    if (state->frame_pool_count == 0)
+        return create_frame(state, geometry);
+
+    Window frame = state->frame_pool[--state->frame_pool_count];
+    XMoveResizeWindow(state->dpy, frame, geometry->x, geometry->y,
+                      geometry->width, geometry->height);
+    return frame;
+}
+
+void release_frame(PSWMState *state, Window frame)
+{
+    // Frames above the high-water mark are not worth keeping
+    if (state->frame_pool_count >= state->config.frame_pool_max) {
+        XDestroyWindow(state->dpy, frame);
+        return;
+    }
+
+    XUnmapWindow(state->dpy, frame);
+    state->frame_pool[state->frame_pool_count++] = frame;
+}
+
+int wants_fullscreen(PSWMState *state, PSWMClient *client)
+{
+    Window w = client->window;
+
+    // Per-class rules from the config file
+    if (state->config.fullscreen_count > 0)
+        update_client_class(state, client);
+
+    for (int i = 0; i < state->config.fullscreen_count; ++i) {
+        char *class = state->config.fullscreen_classes[i];
+        if (strcmp(client->instance, class) == 0 || strcmp(client->class, class) == 0)
+            return 1;
+    }
+
+    // Clients can also ask for it before mapping through _NET_WM_STATE
+    Atom type;
+    int format;
+    unsigned long count, after;
+    unsigned char *data = NULL;
+    int fullscreen = 0;
+
+    if (XGetWindowProperty(state->dpy, w, state->net_wm_state, 0, NET_WM_STATE_MAX, False, XA_ATOM,
+                           &type, &format, &count, &after, &data) == Success && data) {
+        Atom *atoms = (Atom *)data;
+        for (unsigned long i = 0; i < count; ++i)
+            if (atoms[i] == state->net_wm_state_fullscreen)
+                fullscreen = 1;
+        XFree(data);
+    }
+
+    return fullscreen;
+}
+
+void update_client_title(PSWMState *state, PSWMClient *client)
+{
+    Atom type;
+    int format;
+    unsigned long length, after;
+    unsigned char *data = NULL;
+
+    // Prefer the UTF-8 _NET_WM_NAME, lots of clients only keep that one current
+    client->title[0] = '\0';
+    if (XGetWindowProperty(state->dpy, client->window, state->net_wm_name, 0, TITLE_SIZE/4, False,
+                           state->utf8_string, &type, &format, &length, &after, &data) == Success && data) {
+        if (type == state->utf8_string && length > 0)
+            snprintf(client->title, TITLE_SIZE, "%.*s", (int)length, (char *)data);
+        XFree(data);
+    }
+
+    char *name = NULL;
+    if (client->title[0] == '\0' && XFetchName(state->dpy, client->window, &name) && name) {
+        snprintf(client->title, TITLE_SIZE, "%s", name);
+        XFree(name);
+    }
+
+    update_client_search(client);
+}
+
+void update_client_class(PSWMState *state, PSWMClient *client)
+{
+    XClassHint hint;
+    client->instance[0] = '\0';
+    client->class[0] = '\0';
+    if (XGetClassHint(state->dpy, client->window, &hint)) {
+        if (hint.res_name)
+            snprintf(client->instance, TITLE_SIZE, "%s", hint.res_name);
+        if (hint.res_class)
+            snprintf(client->class, TITLE_SIZE, "%s", hint.res_class);
+        XFree(hint.res_name);
+        XFree(hint.res_class);
+    }
+
+    update_client_search(client);
+}
+
+void update_client_search(PSWMClient *client)
+{
+    // Lowercased once here so matching while typing is a plain strstr
+    snprintf(client->search, sizeof(client->search), "%s\t%s\t%s",
+             client->title, client->instance, client->class);
+    for (int i = 0; client->search[i] != '\0'; ++i)
+        client->search[i] = tolower((unsigned char)client->search[i]);
 }
 
 PSWMClient *find_client(PSWMState *state, Window w)
@@ -278,6 +528,10 @@ int setup(PSWMState *state, int display_number)
         return 1;
     }
     XSetErrorHandler(handle_xerror);
+#ifdef PSWM_TRACE
+    XSetAfterFunction(state->dpy, trace_after);
+    trace_request = NextRequest(state->dpy);
+#endif
 
     state->font = XLoadQueryFont(state->dpy, FONT_PATH);
     if (!state->font) {
@@ -291,11 +545,44 @@ int setup(PSWMState *state, int display_number)
     int dummy;
     state->has_randr = XRRQueryExtension(state->dpy, &state->randr_base, &dummy);
 
+    // Asked once here so fullscreening a window doesn't pay for it
+    int randr_major = 0, randr_minor = 0;
+    state->has_randr_monitors = state->has_randr &&
+                                XRRQueryVersion(state->dpy, &randr_major, &randr_minor) &&
+                                (randr_major > 1 || (randr_major == 1 && randr_minor >= 5));
+
+    state->net_supported = XInternAtom(state->dpy, "_NET_SUPPORTED", False);
+    state->net_supporting_wm_check = XInternAtom(state->dpy, "_NET_SUPPORTING_WM_CHECK", False);
+    state->net_wm_name = XInternAtom(state->dpy, "_NET_WM_NAME", False);
+    state->utf8_string = XInternAtom(state->dpy, "UTF8_STRING", False);
+    state->net_wm_state = XInternAtom(state->dpy, "_NET_WM_STATE", False);
+    state->net_wm_state_fullscreen = XInternAtom(state->dpy, "_NET_WM_STATE_FULLSCREEN", False);
+
+    Atom supported[] = {
+        state->net_supporting_wm_check, state->net_wm_name,
+        state->net_wm_state, state->net_wm_state_fullscreen,
+    };
+    XChangeProperty(state->dpy, state->root, state->net_supported, XA_ATOM, 32,
+                    PropModeReplace, (unsigned char *)supported, sizeof(supported)/sizeof(supported[0]));
+
+    // Toolkits like SDL only send _NET_WM_STATE messages when they find this window
+    state->wm_check = XCreateSimpleWindow(state->dpy, state->root, -1, -1, 1, 1, 0, 0, 0);
+    XChangeProperty(state->dpy, state->wm_check, state->net_supporting_wm_check, XA_WINDOW, 32,
+                    PropModeReplace, (unsigned char *)&state->wm_check, 1);
+    XChangeProperty(state->dpy, state->wm_check, state->net_wm_name, state->utf8_string, 8,
+                    PropModeReplace, (unsigned char *)"pswm", 4);
+    XChangeProperty(state->dpy, state->root, state->net_supporting_wm_check, XA_WINDOW, 32,
+                    PropModeReplace, (unsigned char *)&state->wm_check, 1);
+
 #define PATH_SIZE 256
     state->config.path = calloc(PATH_SIZE + 1, sizeof(char));
     strcat(state->config.path, getenv("HOME"));
     strcat(state->config.path, "/.pswmrc");
 
+    state->config.frame_pool_max = DEFAULT_FRAME_POOL;
+    state->config.focus_policy = FOCUS_MOUSE;
+    state->config.focus_delay = DEFAULT_FOCUS_DELAY;
+
     FILE *f = fopen(state->config.path, "r");
     if (!f) {
         create_config_file(state->config.path);
@@ -307,6 +594,18 @@ int setup(PSWMState *state, int display_number)
     state->cursor_drag = XCreateFontCursor(state->dpy, XC_fleur);
     state->cursor_resize = XCreateFontCursor(state->dpy, XC_plus);
 
+    XSetWindowAttributes picker_attr;
+    picker_attr.override_redirect = True;
+    picker_attr.background_pixel = BlackPixel(state->dpy, 0);
+    picker_attr.event_mask = ExposureMask;
+    state->picker = XCreateWindow(state->dpy, state->root, 0, 0, PICKER_WIDTH, 1, 1,
+                                  CopyFromParent, InputOutput, CopyFromParent,
+                                  CWOverrideRedirect | CWBackPixel | CWEventMask, &picker_attr);
+
+    state->picker_gc = XCreateGC(state->dpy, state->picker, 0, NULL);
+    XSetFont(state->dpy, state->picker_gc, state->font->fid);
+    XSetForeground(state->dpy, state->picker_gc, WhitePixel(state->dpy, 0));
+
     unsigned int input_mask = KeyPressMask|MouseMask|ChildMask;
     XSelectInput(state->dpy, state->root, input_mask);
     XRRSelectInput(state->dpy, state->root, RRScreenChangeNotifyMask);
@@ -317,6 +616,12 @@ int setup(PSWMState *state, int display_number)
     state->current_client = NULL;
     state->clients = clientlist_new();
 
+    // Pre-create frames so mapping a window doesn't have to allocate one
+    XWindowAttributes frame_geometry = { .width = 1, .height = 1 };
+    state->frame_pool = calloc(state->config.frame_pool_max + 1, sizeof(Window));
+    for (int i = 0; i < state->config.frame_pool_max; ++i)
+        state->frame_pool[state->frame_pool_count++] = create_frame(state, &frame_geometry);
+
     return 0;
 }
 
@@ -345,7 +650,17 @@ void read_config_file(FILE *f, PSWMConfig *config)
             char *term = parse_term(split[1]);
             config->terminal = calloc(strlen(term) + 1, sizeof(char));
             strcpy(config->terminal, term);
-        }
+        } else if (strcmp(split[0], "fullscreen") == 0) {
+            config->fullscreen_classes = realloc(config->fullscreen_classes,
+                                                 (config->fullscreen_count + 1)*sizeof(char *));
+            config->fullscreen_classes[config->fullscreen_count] = strdup(split[1]);
+            ++config->fullscreen_count;
+        } else if (strcmp(split[0], "frame_pool") == 0)
+            config->frame_pool_max = max(0, atoi(split[1]));
+        else if (strcmp(split[0], "focus") == 0)
+            config->focus_policy = (strcmp(split[1], "click") == 0)? FOCUS_CLICK : FOCUS_MOUSE;
+        else if (strcmp(split[0], "focus_delay") == 0)
+            config->focus_delay = max(0, atoi(split[1]));
 
         for (int i = 0; i < split_count; ++i)
             free(split[i]);
@@ -417,7 +732,7 @@ void grab_keys(PSWMState *state)
     XUngrabKey(state->dpy, AnyKey, AnyModifier, state->root);
 
     KeySym keys_to_grab[] = {
-        KEY_NEW, KEY_NEXT, KEY_LEFT, KEY_DOWN, KEY_UP, KEY_RIGHT, KEY_MAXIMIZE,
+        KEY_NEW, KEY_NEXT, KEY_LEFT, KEY_DOWN, KEY_UP, KEY_RIGHT, KEY_MAXIMIZE, KEY_SEARCH,
     };
 
 #define NUM_GRABS (sizeof(keys_to_grab)/sizeof(keys_to_grab[0]))
@@ -448,6 +763,18 @@ void event_main_loop(PSWMState *state)
 {
     XEvent ev;
     while (!state->exit) {
+        // A pending focus is committed focus_delay ms after the last EnterNotify,
+        // handle_enter pushes the deadline back on every crossing
+        if (state->pending_focus != None && !XPending(state->dpy)) {
+            if (!wait_for_event(state)) {
+                commit_pending_focus(state);
+                continue;
+            }
+
+            if (!XPending(state->dpy))
+                continue;
+        }
+
         XNextEvent(state->dpy, &ev);
 
         switch (ev.type) {
@@ -456,21 +783,35 @@ void event_main_loop(PSWMState *state)
                     handle_key_press(state, &ev.xkey);
                 break;
             case ButtonPress:
-                if (ev.xbutton.subwindow != None)
+                if (ev.xbutton.window != state->root)
+                    TRACE(state, "click focus", 3, 0, handle_click_focus(state, &ev.xbutton));
+                else if (ev.xbutton.subwindow != None)
                     handle_button_press(state, &ev.xbutton);
                 break;
             case ConfigureRequest:
                 handle_configure_request(state, &ev.xconfigurerequest);
                 break;
             case MapRequest:
-                handle_map_request(state, &ev.xmaprequest);
+                // Worst cases, both with fullscreen rules configured and click-to-focus:
+                // a client asking for fullscreen itself (13 requests, 6 round trips) and
+                // a framed client with the frame pool empty (12 requests, 4 round trips)
+                TRACE(state, "map", 13, 6, handle_map_request(state, &ev.xmaprequest));
                 break;
             case UnmapNotify:
-                handle_unmap(state, &ev.xunmap);
+                TRACE(state, "unmap", 2, 0, handle_unmap(state, &ev.xunmap));
                 break;
             case EnterNotify:
                 handle_enter(state, &ev.xcrossing);
                 break;
+            case FocusIn: case FocusOut:
+                handle_focus(state, &ev.xfocus);
+                break;
+            case ClientMessage:
+                handle_client_message(state, &ev.xclient);
+                break;
+            case PropertyNotify:
+                handle_property(state, &ev.xproperty);
+                break;
             default:
                 if (state->has_randr && ev.type == state->randr_base + RRScreenChangeNotify)
                     XRRUpdateConfiguration(&ev);
@@ -480,8 +821,62 @@ void event_main_loop(PSWMState *state)
 
 }
 
+long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000 + ts.tv_nsec/1000000;
+}
+
+int wait_for_event(PSWMState *state)
+{
+    long remaining = state->pending_focus_deadline - now_ms();
+    if (remaining <= 0)
+        return 0;
+
+    int fd = ConnectionNumber(state->dpy);
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(fd, &fds);
+
+    struct timeval timeout = { remaining/1000, (remaining%1000)*1000 };
+    return select(fd + 1, &fds, NULL, NULL, &timeout) > 0;
+}
+
+#ifdef PSWM_TRACE
+int trace_after(Display *dpy)
+{
+    // Xlib calls this after every function that sends requests. If the server has
+    // already answered requests this call sent, Xlib waited for those replies.
+    unsigned long next = NextRequest(dpy);
+    unsigned long read = LastKnownRequestProcessed(dpy);
+    if (read >= trace_request)
+        trace_round_trips += ((read < next)? read + 1 : next) - trace_request;
+
+    trace_request = next;
+    return 0;
+}
+
+void trace_check(const char *action, unsigned long requests, int round_trips,
+                 unsigned long max_requests, int max_round_trips)
+{
+    fprintf(stderr, "pswm: trace: %s: %lu requests, %d round trips\n", action, requests, round_trips);
+    if (requests > max_requests || round_trips > max_round_trips) {
+        fprintf(stderr, "pswm: trace: %s over budget (%lu requests, %d round trips allowed)\n",
+                action, max_requests, max_round_trips);
+        abort();
+    }
+}
+#endif
+
 int handle_xerror(Display *dpy, XErrorEvent *ev)
 {
+    // handle_unmap reparents the client out of its frame, which is already gone
+    // when the unmap came from the client destroying its window
+    if (ev->error_code == BadWindow && ev->request_code == X_ReparentWindow &&
+        ev->serial == withdraw_reparent_serial)
+        return 0;
+
     char error_text[1024];
     XGetErrorText(dpy, ev->error_code, error_text, 1024);
     printf("pswm: X Error: %s\n", error_text);
@@ -498,14 +893,17 @@ void handle_key_press(PSWMState *state, XKeyEvent *ev)
             spawn(state, state->config.terminal);
             break;
         case KEY_NEXT:
-            next_client(state);
+            switch_clients(state);
+            break;
+        case KEY_SEARCH:
+            search_clients(state);
             break;
         case KEY_LEFT: case KEY_DOWN: case KEY_UP: case KEY_RIGHT:
             if (ev->subwindow != None)
-                move_window(state, key, ev);
+                TRACE(state, "move", 4, 0, move_window(state, key, ev));
             break;
         case KEY_MAXIMIZE:
-            maximize_window(state, ev);
+            TRACE(state, "maximize", 4, 0, maximize_window(state, ev));
             break;
         default:
             break;
@@ -535,25 +933,58 @@ void handle_configure_request(PSWMState *state, XConfigureRequestEvent *ev)
     wc.y = ev->y;
     wc.width = ev->width;
     wc.height = ev->height;
+    wc.border_width = ev->border_width;
+    wc.sibling = ev->above;
+    wc.stack_mode = ev->detail;
+
+    unsigned long value_mask = ev->value_mask;
+
+    // Unframed fullscreen clients get their requests as-is, but their stacking
+    // sibling has to be a toplevel, so map a client's window to its frame
+    if (client && client->fullscreen && (value_mask & CWSibling)) {
+        PSWMClient *sibling = find_client(state, ev->above);
+        if (sibling && sibling->parent != None)
+            wc.sibling = sibling->parent;
+        else if (!sibling)
+            value_mask &= ~(CWSibling | CWStackMode);
+    }
 
-    Window window_to_configure = client? client->parent : ev->window;
-    XConfigureWindow(state->dpy, window_to_configure, ev->value_mask, &wc);
+    Window window_to_configure = (client && !client->fullscreen)? client->parent : ev->window;
+    if (client && !client->fullscreen) {
+        if (ev->value_mask & CWX) client->attr.x = ev->x;
+        if (ev->value_mask & CWY) client->attr.y = ev->y;
+        if (ev->value_mask & CWWidth) client->attr.width = ev->width;
+        if (ev->value_mask & CWHeight) client->attr.height = ev->height;
+    }
+
+    XConfigureWindow(state->dpy, window_to_configure, value_mask, &wc);
 }
 
 void handle_map_request(PSWMState *state, XMapRequestEvent *ev)
 {
     PSWMClient *client = find_client(state, ev->window);
-    if (!client)
-        client = init_client(state, ev->window);
+    if (!client) {
+        PSWMClient *c = init_client(state, ev->window);
+        state->clients = clientlist_append(state->clients, c);
+        free(c);
+        client = find_client(state, ev->window);
+    }
+
+    state->current_client = client;
 
-    state->clients = clientlist_append(state->clients, client);
-    state->current_client = state->clients;
+    if (client->fullscreen) {
+        client->fullscreen = 0;
+        set_fullscreen(state, client, 1);
+        XMapWindow(state->dpy, client->window);
+        focus_client(state, client);
+        return;
+    }
 
     XMapWindow(state->dpy, client->window);
     XMapWindow(state->dpy, client->parent);
     XReparentWindow(state->dpy, client->window, client->parent, 0, 0);
     XRaiseWindow(state->dpy, client->parent);
-    XSetInputFocus(state->dpy, client->window, RevertToPointerRoot, CurrentTime);
+    focus_client(state, client);
 }
 
 void handle_unmap(PSWMState *state, XUnmapEvent *ev)
@@ -562,13 +993,32 @@ void handle_unmap(PSWMState *state, XUnmapEvent *ev)
     if (!client)
         return;
 
-    if (ev->event == client->parent) {
-        XUnmapWindow(state->dpy, client->parent);
-        XReparentWindow(state->dpy, client->parent, state->root, client->attr.x, client->attr.y);
-        XDestroyWindow(state->dpy, client->parent);
+    // Unmaps caused by our own reparenting between frame and root
+    if (ev->window == client->window && client->ignore_unmap > 0) {
+        --client->ignore_unmap;
+        return;
+    }
+
+    int unframed_withdraw = client->fullscreen && ev->event == state->root &&
+                            ev->window == client->window;
+
+    if (ev->event == client->parent || unframed_withdraw) {
+        if (client->parent != None) {
+            // Hand the client back to the root before its frame gets reused, if the
+            // window was destroyed this fails quietly in handle_xerror
+            withdraw_reparent_serial = NextRequest(state->dpy);
+            XReparentWindow(state->dpy, client->window, state->root, client->attr.x, client->attr.y);
+            release_frame(state, client->parent);
+        }
+        if (state->focused == client->window)
+            state->focused = None;
         client->window = None;
         client->parent = None;
+        if (state->current_client == client)
+            state->current_client = NULL;
         state->clients = clientlist_delete(state->clients, client);
+        if (!state->current_client)
+            state->current_client = state->clients;
     }
 }
 
@@ -577,13 +1027,102 @@ void handle_enter(PSWMState *state, XCrossingEvent *ev)
     if (ev->mode != NotifyNormal || ev->mode == NotifyInferior)
         return;
 
+    if (state->config.focus_policy != FOCUS_MOUSE)
+        return;
+
     Window window_to_enter = (ev->subwindow != None)? ev->subwindow : ev->window;
 
     PSWMClient *client = find_client(state, window_to_enter);
     if (!client)
         return;
 
-    XSetInputFocus(state->dpy, client->window, RevertToPointerRoot, CurrentTime);
+    // Back on the focused window, whatever was pending is stale
+    if (client->window == state->focused) {
+        state->pending_focus = None;
+        return;
+    }
+
+    state->pending_focus = client->window;
+    state->pending_focus_deadline = now_ms() + state->config.focus_delay;
+    if (state->config.focus_delay == 0)
+        commit_pending_focus(state);
+}
+
+void handle_click_focus(PSWMState *state, XButtonEvent *ev)
+{
+    PSWMClient *client = find_client(state, ev->window);
+    if (client)
+        activate_client(state, client);
+
+    XAllowEvents(state->dpy, ReplayPointer, ev->time);
+}
+
+void handle_focus(PSWMState *state, XFocusChangeEvent *ev)
+{
+    // Keyboard grabs don't move the focus, and neither do crossings inside a client
+    if (ev->mode == NotifyGrab || ev->mode == NotifyUngrab)
+        return;
+    if (ev->detail == NotifyInferior || ev->detail == NotifyPointer)
+        return;
+
+    PSWMClient *client = find_client(state, ev->window);
+    if (!client || client->window != ev->window)
+        return;
+
+    // Clients may set the focus themselves, so focus_client can only skip
+    // requests when this is kept up to date
+    if (ev->type == FocusIn)
+        state->focused = client->window;
+    else if (state->focused == client->window)
+        state->focused = None;
+}
+
+void handle_client_message(PSWMState *state, XClientMessageEvent *ev)
+{
+    if (ev->message_type != state->net_wm_state)
+        return;
+
+    PSWMClient *client = find_client(state, ev->window);
+    if (!client)
+        return;
+
+    if ((Atom)ev->data.l[1] != state->net_wm_state_fullscreen &&
+        (Atom)ev->data.l[2] != state->net_wm_state_fullscreen)
+        return;
+
+    int fullscreen = client->fullscreen;
+    switch (ev->data.l[0]) {
+        case NET_WM_STATE_REMOVE:
+            set_fullscreen(state, client, 0);
+            break;
+        case NET_WM_STATE_ADD:
+            set_fullscreen(state, client, 1);
+            break;
+        case NET_WM_STATE_TOGGLE:
+            set_fullscreen(state, client, !client->fullscreen);
+            break;
+        default:
+            break;
+    }
+
+    if (client->fullscreen != fullscreen)
+        focus_client(state, client);
+}
+
+void handle_property(PSWMState *state, XPropertyEvent *ev)
+{
+    if (ev->atom != XA_WM_NAME && ev->atom != state->net_wm_name && ev->atom != XA_WM_CLASS)
+        return;
+
+    // Clients nobody searched for yet get indexed when a picker opens
+    PSWMClient *client = find_client(state, ev->window);
+    if (!client || client->window != ev->window || !client->indexed)
+        return;
+
+    if (ev->atom == XA_WM_NAME || ev->atom == state->net_wm_name)
+        update_client_title(state, client);
+    else
+        update_client_class(state, client);
 }
 
 void spawn(PSWMState *state, const char *cmd)
@@ -599,48 +1138,54 @@ void spawn(PSWMState *state, const char *cmd)
     }
 }
 
-void next_client(PSWMState *state)
+void activate_client(PSWMState *state, PSWMClient *client)
 {
-    if (!state->clients || !state->current_client)
+    state->current_client = client;
+    XRaiseWindow(state->dpy, client->fullscreen? client->window : client->parent);
+    focus_client(state, client);
+}
+
+void focus_client(PSWMState *state, PSWMClient *client)
+{
+    state->pending_focus = None;
+    client->focus_stamp = ++state->focus_counter;
+    if (client->window == state->focused)
         return;
 
-    PSWMClient *client = state->current_client->next;
-    state->current_client = client;
-    XRaiseWindow(state->dpy, state->current_client->parent);
-    XSetInputFocus(state->dpy, state->current_client->window, RevertToPointerRoot, CurrentTime);
+    // state->focused is only set from FocusIn, a request the server rejects
+    // must not make later ones look redundant
+    XSetInputFocus(state->dpy, client->window, RevertToPointerRoot, CurrentTime);
+}
+
+void commit_pending_focus(PSWMState *state)
+{
+    PSWMClient *client = find_client(state, state->pending_focus);
+    state->pending_focus = None;
+    if (client)
+        TRACE(state, "focus", 1, 0, focus_client(state, client));
 }
 
 void move_window(PSWMState *state, KeySym key, XKeyEvent *ev)
 {
     PSWMClient *client = find_client(state, ev->subwindow);
-    if (!client)
+    if (!client || client->fullscreen)
         return;
 
-    XGetWindowAttributes(state->dpy, client->parent, &client->attr);
     XRaiseWindow(state->dpy, client->parent);
-    XSetInputFocus(state->dpy, client->window, RevertToPointerRoot, CurrentTime);
+    focus_client(state, client);
 
+    // client->attr tracks the frame geometry, so there's no need to ask the server
     switch (key) {
-        case KEY_LEFT:
-            XMoveWindow(state->dpy, client->parent, client->attr.x - 16, client->attr.y);
-            XMoveWindow(state->dpy, client->window, 0, 0);
-            break;
-        case KEY_DOWN:
-            XMoveWindow(state->dpy, client->parent, client->attr.x, client->attr.y + 16);
-            XMoveWindow(state->dpy, client->window, 0, 0);
-            break;
-        case KEY_UP:
-            XMoveWindow(state->dpy, client->parent, client->attr.x, client->attr.y - 16);
-            XMoveWindow(state->dpy, client->window, 0, 0);
-            break;
-        case KEY_RIGHT:
-            XMoveWindow(state->dpy, client->parent, client->attr.x + 16, client->attr.y);
-            XMoveWindow(state->dpy, client->window, 0, 0);
-            break;
+        case KEY_LEFT:  client->attr.x -= 16; break;
+        case KEY_DOWN:  client->attr.y += 16; break;
+        case KEY_UP:    client->attr.y -= 16; break;
+        case KEY_RIGHT: client->attr.x += 16; break;
     }
 
+    XMoveWindow(state->dpy, client->parent, client->attr.x, client->attr.y);
+    XMoveWindow(state->dpy, client->window, 0, 0);
+
     // Update init_attr to match some current attr fields
-    XGetWindowAttributes(state->dpy, client->parent, &client->attr);
     client->init_attr.x = client->attr.x;
     client->init_attr.y = client->attr.y;
 }
@@ -648,7 +1193,7 @@ void move_window(PSWMState *state, KeySym key, XKeyEvent *ev)
 void maximize_window(PSWMState *state, XKeyEvent *ev)
 {
     PSWMClient *client = find_client(state, ev->subwindow);
-    if (!client)
+    if (!client || client->fullscreen)
         return;
 
     int display_width = XDisplayWidth(state->dpy, 0);
@@ -661,16 +1206,21 @@ void maximize_window(PSWMState *state, XKeyEvent *ev)
     int width = client->maximized? display_width : client->init_attr.width;
     int height = client->maximized? display_height : client->init_attr.height;
 
+    client->attr.x = x;
+    client->attr.y = y;
+    client->attr.width = width;
+    client->attr.height = height;
+
     XMoveResizeWindow(state->dpy, client->parent, x, y, width, height);
     XMoveResizeWindow(state->dpy, client->window, 0, 0, width, height);
     XRaiseWindow(state->dpy, client->parent);
-    XSetInputFocus(state->dpy, client->window, RevertToPointerRoot, CurrentTime);
+    focus_client(state, client);
 }
 
 void drag_window(PSWMState *state, XButtonEvent *ev)
 {
     PSWMClient *client = find_client(state, ev->subwindow);
-    if (!client)
+    if (!client || client->fullscreen)
         return;
 
     if (XGrabPointer(state->dpy, state->root,
@@ -679,7 +1229,7 @@ void drag_window(PSWMState *state, XButtonEvent *ev)
         return;
 
     XRaiseWindow(state->dpy, client->parent);
-    XSetInputFocus(state->dpy, client->window, RevertToPointerRoot, CurrentTime);
+    focus_client(state, client);
 
     XEvent xev;
     for (;;) {
@@ -691,8 +1241,9 @@ void drag_window(PSWMState *state, XButtonEvent *ev)
 
                 int xdiff = xev.xbutton.x_root - ev->x_root;
                 int ydiff = xev.xbutton.y_root - ev->y_root;
-                XMoveWindow(state->dpy, client->parent, client->attr.x + xdiff, client->attr.y + ydiff);
-                XMoveWindow(state->dpy, client->window, 0, 0);
+                TRACE(state, "drag", 2, 0,
+                      XMoveWindow(state->dpy, client->parent, client->attr.x + xdiff, client->attr.y + ydiff);
+                      XMoveWindow(state->dpy, client->window, 0, 0));
                 break;
             case ButtonRelease:
                 XUngrabPointer(state->dpy, CurrentTime);
@@ -712,7 +1263,7 @@ void drag_window(PSWMState *state, XButtonEvent *ev)
 void resize_window(PSWMState *state, XButtonEvent *ev)
 {
     PSWMClient *client = find_client(state, ev->subwindow);
-    if (!client)
+    if (!client || client->fullscreen)
         return;
 
     if (XGrabPointer(state->dpy, state->root,
@@ -723,7 +1274,7 @@ void resize_window(PSWMState *state, XButtonEvent *ev)
     int width, height;
 
     XRaiseWindow(state->dpy, client->parent);
-    XSetInputFocus(state->dpy, client->window, RevertToPointerRoot, CurrentTime);
+    focus_client(state, client);
 
     XEvent xev;
     for (;;) {
@@ -755,3 +1306,347 @@ void resize_window(PSWMState *state, XButtonEvent *ev)
         }
     }
 }
+
+void monitor_geometry(PSWMState *state, PSWMClient *client, int *x, int *y, int *width, int *height)
+{
+    *x = 0;
+    *y = 0;
+    *width = XDisplayWidth(state->dpy, 0);
+    *height = XDisplayHeight(state->dpy, 0);
+
+    if (!state->has_randr_monitors)
+        return;
+
+    int count = 0;
+    XRRMonitorInfo *monitors = XRRGetMonitors(state->dpy, state->root, True, &count);
+    if (!monitors)
+        return;
+
+    // Pick the monitor that holds the center of the window
+    int cx = client->init_attr.x + client->init_attr.width/2;
+    int cy = client->init_attr.y + client->init_attr.height/2;
+    for (int i = 0; i < count; ++i) {
+        XRRMonitorInfo *m = &monitors[i];
+        if (cx >= m->x && cx < m->x + m->width && cy >= m->y && cy < m->y + m->height) {
+            *x = m->x;
+            *y = m->y;
+            *width = m->width;
+            *height = m->height;
+            break;
+        }
+    }
+
+    XRRFreeMonitors(monitors);
+}
+
+// Callers focus the client afterwards, on a map it isn't viewable yet at this point
+void set_fullscreen(PSWMState *state, PSWMClient *client, int fullscreen)
+{
+    if (client->fullscreen == fullscreen)
+        return;
+
+    client->fullscreen = fullscreen;
+
+    if (fullscreen) {
+        int x, y, width, height;
+        monitor_geometry(state, client, &x, &y, &width, &height);
+
+        unframe_client(state, client);
+        XMoveResizeWindow(state->dpy, client->window, x, y, width, height);
+        update_net_wm_state(state, client, 1);
+        XRaiseWindow(state->dpy, client->window);
+    } else {
+        update_net_wm_state(state, client, 0);
+        frame_client(state, client);
+        XRaiseWindow(state->dpy, client->parent);
+    }
+}
+
+void update_net_wm_state(PSWMState *state, PSWMClient *client, int fullscreen)
+{
+    Atom states[NET_WM_STATE_MAX + 1];
+    int count = 0;
+
+    Atom type;
+    int format;
+    unsigned long found, after;
+    unsigned char *data = NULL;
+
+    // Keep whatever other states the client set, only FULLSCREEN is ours
+    if (XGetWindowProperty(state->dpy, client->window, state->net_wm_state, 0, NET_WM_STATE_MAX,
+                           False, XA_ATOM, &type, &format, &found, &after, &data) == Success && data) {
+        Atom *atoms = (Atom *)data;
+        for (unsigned long i = 0; i < found; ++i)
+            if (atoms[i] != state->net_wm_state_fullscreen)
+                states[count++] = atoms[i];
+        XFree(data);
+    }
+
+    if (fullscreen)
+        states[count++] = state->net_wm_state_fullscreen;
+
+    XChangeProperty(state->dpy, client->window, state->net_wm_state, XA_ATOM, 32,
+                    PropModeReplace, (unsigned char *)states, count);
+}
+
+void frame_client(PSWMState *state, PSWMClient *client)
+{
+    client->maximized = 0;
+    client->attr = client->init_attr;
+
+    if (client->parent == None)
+        client->parent = acquire_frame(state, &client->init_attr);
+    else
+        XMoveResizeWindow(state->dpy, client->parent, client->init_attr.x, client->init_attr.y,
+                          client->init_attr.width, client->init_attr.height);
+    XResizeWindow(state->dpy, client->window, client->init_attr.width, client->init_attr.height);
+
+    // The frame carries the click-to-focus grab again
+    if (state->config.focus_policy == FOCUS_CLICK)
+        XUngrabButton(state->dpy, AnyButton, AnyModifier, client->window);
+
+    ++client->ignore_unmap;
+    XReparentWindow(state->dpy, client->window, client->parent, 0, 0);
+    XMapWindow(state->dpy, client->parent);
+}
+
+void unframe_client(PSWMState *state, PSWMClient *client)
+{
+    // Without a frame the click-to-focus grab goes on the client itself
+    if (state->config.focus_policy == FOCUS_CLICK)
+        XGrabButton(state->dpy, AnyButton, AnyModifier, client->window, False, ButtonPressMask,
+                    GrabModeSync, GrabModeAsync, None, None);
+
+    if (client->parent == None)
+        return;
+
+    ++client->ignore_unmap;
+    XReparentWindow(state->dpy, client->window, state->root, 0, 0);
+    release_frame(state, client->parent);
+    client->parent = None;
+}
+
+PSWMClient **clients_by_mru(PSWMState *state, int *count)
+{
+    *count = 0;
+    if (!state->clients)
+        return NULL;
+
+    PSWMClient *client = state->clients;
+    do {
+        ++(*count);
+        client = client->next;
+    } while (client != state->clients);
+
+    PSWMClient **mru = malloc(*count*sizeof(PSWMClient *));
+    for (int i = 0; i < *count; ++i, client = client->next) {
+        index_client(state, client);
+        mru[i] = client;
+    }
+
+    qsort(mru, *count, sizeof(PSWMClient *), compare_mru);
+    return mru;
+}
+
+void index_client(PSWMState *state, PSWMClient *client)
+{
+    if (client->indexed)
+        return;
+
+    update_client_class(state, client);
+    update_client_title(state, client);
+    client->indexed = 1;
+}
+
+int compare_mru(const void *a, const void *b)
+{
+    unsigned long stamp_a = (*(PSWMClient **)a)->focus_stamp;
+    unsigned long stamp_b = (*(PSWMClient **)b)->focus_stamp;
+    return (stamp_a < stamp_b) - (stamp_a > stamp_b);
+}
+
+int match_clients(PSWMClient **mru, int count, const char *query, PSWMClient **matches)
+{
+    int found = 0;
+    for (int i = 0; i < count; ++i)
+        if (strstr(mru[i]->search, query))
+            matches[found++] = mru[i];
+
+    return found;
+}
+
+void show_picker(PSWMState *state, int lines)
+{
+    int line_height = state->font->ascent + state->font->descent;
+    int height = lines*line_height + 2*PICKER_PADDING;
+    int x = (XDisplayWidth(state->dpy, 0) - PICKER_WIDTH)/2;
+    int y = (XDisplayHeight(state->dpy, 0) - height)/2;
+
+    XMoveResizeWindow(state->dpy, state->picker, x, y, PICKER_WIDTH, height);
+    XMapRaised(state->dpy, state->picker);
+}
+
+void draw_picker(PSWMState *state, const char *query, PSWMClient **clients, int count, int selected)
+{
+    int line_height = state->font->ascent + state->font->descent;
+    int y = PICKER_PADDING + state->font->ascent;
+    char line[LINE_SIZE];
+
+    XClearWindow(state->dpy, state->picker);
+
+    if (query) {
+        snprintf(line, LINE_SIZE, "> %s", query);
+        XDrawString(state->dpy, state->picker, state->picker_gc, PICKER_PADDING, y, line, strlen(line));
+        y += line_height;
+    }
+
+    // Scroll so the selection stays in view
+    int first = (selected >= PICKER_LINES)? selected - PICKER_LINES + 1 : 0;
+    for (int i = first; i < count && i < first + PICKER_LINES; ++i, y += line_height) {
+        PSWMClient *c = clients[i];
+        snprintf(line, LINE_SIZE, "%c %s (%s)", (i == selected)? '*' : ' ',
+                 (c->title[0] != '\0')? c->title : c->instance, c->class);
+        XDrawString(state->dpy, state->picker, state->picker_gc, PICKER_PADDING, y, line, strlen(line));
+    }
+}
+
+void close_picker(PSWMState *state, PSWMClient *choice)
+{
+    XUngrabKeyboard(state->dpy, CurrentTime);
+    XUnmapWindow(state->dpy, state->picker);
+
+    if (choice)
+        activate_client(state, choice);
+
+    // Unmapping the picker and raising the choice send EnterNotify to whatever is
+    // under the pointer, drop them so focus-follows-mouse doesn't undo the pick
+    XSync(state->dpy, False);
+    XEvent xev;
+    while (XCheckMaskEvent(state->dpy, EnterWindowMask, &xev))
+        ;
+    state->pending_focus = None;
+}
+
+void switch_clients(PSWMState *state)
+{
+    int count;
+    PSWMClient **mru = clients_by_mru(state, &count);
+    if (count < 2) {
+        free(mru);
+        return;
+    }
+
+    if (XGrabKeyboard(state->dpy, state->root, True, GrabModeAsync, GrabModeAsync,
+                      CurrentTime) != GrabSuccess) {
+        free(mru);
+        return;
+    }
+
+    // Mod may have been released before the grab went through, in which case
+    // there is no KeyRelease coming and the pick is already final
+    Window root, child;
+    int root_x, root_y, x, y;
+    unsigned int mask;
+    XQueryPointer(state->dpy, state->root, &root, &child, &root_x, &root_y, &x, &y, &mask);
+    if (!(mask & state->config.modmask)) {
+        close_picker(state, mru[1]);
+        free(mru);
+        return;
+    }
+
+    // Nothing is raised or focused until the modifier is released
+    int selected = 1;
+    show_picker(state, (count < PICKER_LINES)? count : PICKER_LINES);
+
+    XEvent xev;
+    for (;;) {
+        XMaskEvent(state->dpy, KeyPressMask|KeyReleaseMask|ExposureMask, &xev);
+        if (xev.type == Expose) {
+            draw_picker(state, NULL, mru, count, selected);
+            continue;
+        }
+
+        KeySym key = XkbKeycodeToKeysym(state->dpy, xev.xkey.keycode, 0, 0);
+        if (xev.type == KeyPress && key == KEY_NEXT) {
+            selected = (selected + 1)%count;
+            draw_picker(state, NULL, mru, count, selected);
+        } else if (xev.type == KeyPress && key == XK_Escape) {
+            selected = -1;
+            break;
+        } else if (xev.type == KeyRelease && IsModifierKey(key)) {
+            break;
+        }
+    }
+
+    close_picker(state, (selected >= 0)? mru[selected] : NULL);
+    free(mru);
+}
+
+void search_clients(PSWMState *state)
+{
+    int count;
+    PSWMClient **mru = clients_by_mru(state, &count);
+    if (count == 0)
+        return;
+
+    if (XGrabKeyboard(state->dpy, state->root, True, GrabModeAsync, GrabModeAsync,
+                      CurrentTime) != GrabSuccess) {
+        free(mru);
+        return;
+    }
+
+    PSWMClient **matches = malloc(count*sizeof(PSWMClient *));
+    char query[TITLE_SIZE] = { 0 };
+    int query_length = 0;
+    int found = match_clients(mru, count, query, matches);
+    int selected = 0;
+    PSWMClient *choice = NULL;
+
+    show_picker(state, PICKER_LINES + 1);
+
+    XEvent xev;
+    for (;;) {
+        XMaskEvent(state->dpy, KeyPressMask|ExposureMask, &xev);
+        if (xev.type == Expose) {
+            draw_picker(state, query, matches, found, selected);
+            continue;
+        }
+
+        char text[8] = { 0 };
+        KeySym key;
+        int length = XLookupString(&xev.xkey, text, sizeof(text) - 1, &key, NULL);
+        if (key == XK_Escape)
+            break;
+
+        if (key == XK_Return) {
+            if (found > 0)
+                choice = matches[selected];
+            break;
+        }
+
+        if (key == XK_Down || key == XK_Tab) {
+            if (found > 0)
+                selected = (selected + 1)%found;
+        } else if (key == XK_Up) {
+            if (found > 0)
+                selected = (selected + found - 1)%found;
+        } else if (key == XK_BackSpace) {
+            if (query_length > 0)
+                query[--query_length] = '\0';
+            found = match_clients(mru, count, query, matches);
+            selected = 0;
+        } else if (length == 1 && isprint((unsigned char)text[0]) && query_length < TITLE_SIZE - 1) {
+            query[query_length++] = tolower((unsigned char)text[0]);
+            found = match_clients(matches, found, query, matches);
+            selected = 0;
+        } else {
+            continue;
+        }
+
+        draw_picker(state, query, matches, found, selected);
+    }
+
+    close_picker(state, choice);
+    free(matches);
+    free(mru);
+}
@@ -0,0 +1,151 @@
+#!/bin/sh
+# Builds pswm with -DPSWM_TRACE, runs it on Xvfb and drives every traced
+# handler with xdotool: map, unmap, focus, click focus, keyboard move,
+# maximize and drag steps, under the default settings, click-to-focus with
+# an empty frame pool, and a fullscreen rule. Exits non-zero if pswm aborts,
+# prints "over budget" or any X error, or one of the actions was never
+# traced. It also checks that a window picked with Mod+Tab or Mod+/, and a
+# window mapped fullscreen, have focus once the focus delay has passed.
+#
+#   $ sh tests/trace_budgets.sh
+#
+# Needs gcc, Xvfb, xdotool and xterm (or another client given in CLIENT that
+# understands -geometry and -T).
+
+DISPLAY_NUMBER=${DISPLAY_NUMBER:-99}
+CLIENT=${CLIENT:-xterm}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+XVFB_PID=
+PSWM_PID=
+CLIENT_PIDS=
+failed=0
+
+cleanup()
+{
+    [ -n "$PSWM_PID" ] && kill "$PSWM_PID" 2>/dev/null
+    [ -n "$CLIENT_PIDS" ] && kill $CLIENT_PIDS 2>/dev/null
+    [ -n "$XVFB_PID" ] && kill "$XVFB_PID" 2>/dev/null
+    rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+gcc -DPSWM_TRACE -o "$WORK/pswm" "$ROOT/main.c" -lX11 -lXrandr || exit 1
+
+Xvfb ":$DISPLAY_NUMBER" -screen 0 800x600x24 >/dev/null 2>&1 &
+XVFB_PID=$!
+export DISPLAY=":$DISPLAY_NUMBER"
+for i in 1 2 3 4 5 6 7 8 9 10; do
+    xdotool getmouselocation >/dev/null 2>&1 && break
+    sleep 0.5
+done
+
+# start_session <name> <pswmrc contents>
+start_session()
+{
+    SESSION=$1
+    LOG="$WORK/$SESSION.log"
+    mkdir -p "$WORK/$SESSION"
+    printf '%s\n' "$2" > "$WORK/$SESSION/.pswmrc"
+    HOME="$WORK/$SESSION" "$WORK/pswm" "$DISPLAY_NUMBER" > "$LOG" 2>&1 &
+    PSWM_PID=$!
+    sleep 1
+}
+
+# spawn <title> <geometry>, sets WINDOW to the client window
+spawn()
+{
+    "$CLIENT" -geometry "$2" -T "$1" >/dev/null 2>&1 &
+    CLIENT_PIDS="$CLIENT_PIDS $!"
+    WINDOW=$(xdotool search --sync --name "^$1\$" | head -n 1)
+    sleep 0.5
+}
+
+# expect_focus <window> <what>
+expect_focus()
+{
+    sleep 0.3
+    if [ "$(xdotool getwindowfocus)" != "$1" ]; then
+        echo "$SESSION: $2 lost focus"
+        failed=1
+    fi
+}
+
+# end_session <traced actions...>
+end_session()
+{
+    sleep 0.5
+    if ! kill -0 "$PSWM_PID" 2>/dev/null; then
+        echo "$SESSION: pswm exited"
+        failed=1
+    fi
+
+    kill "$PSWM_PID" 2>/dev/null
+    wait "$PSWM_PID" 2>/dev/null
+    PSWM_PID=
+    kill $CLIENT_PIDS 2>/dev/null
+    CLIENT_PIDS=
+
+    if grep "over budget" "$LOG"; then
+        failed=1
+    fi
+
+    if grep "X Error" "$LOG"; then
+        failed=1
+    fi
+
+    for action in "$@"; do
+        if ! grep -q "trace: $action:" "$LOG"; then
+            echo "$SESSION: '$action' was never traced"
+            failed=1
+        fi
+    done
+}
+
+start_session default "mask mod1"
+spawn pswm-a 40x10+20+20
+WINDOW_A=$WINDOW
+spawn pswm-b 40x10+400+300
+WINDOW_B=$WINDOW
+PID_B=${CLIENT_PIDS##* }
+xdotool mousemove 100 60 sleep 0.3 mousemove 480 340 sleep 0.3
+xdotool mousemove 100 60 sleep 0.3 key alt+l sleep 0.2 key alt+j
+xdotool key alt+x sleep 0.2 key alt+x
+xdotool mousemove 100 60 keydown alt mousedown 1 \
+        mousemove_relative 10 10 mousemove_relative 10 10 mouseup 1 keyup alt
+# The pointer rests on B, under the centred picker, while A gets picked
+xdotool mousemove 480 300 sleep 0.3
+xdotool key alt+slash sleep 0.2 type pswm-a
+xdotool key Return
+expect_focus "$WINDOW_A" "window picked by search"
+xdotool keydown alt key Tab keyup alt
+expect_focus "$WINDOW_B" "window picked by switcher"
+xdotool keydown alt key Tab keyup alt
+expect_focus "$WINDOW_A" "window picked by switcher"
+kill "$PID_B"
+end_session map unmap focus move maximize drag
+
+start_session click "mask mod1
+focus click
+frame_pool 0
+fullscreen no-such-class"
+spawn pswm-a 40x10+20+20
+spawn pswm-b 40x10+400+300
+xdotool mousemove 100 60 click 1 sleep 0.2 mousemove 480 340 click 1
+kill ${CLIENT_PIDS##* }
+end_session map "click focus" unmap
+
+start_session fullscreen "mask mod1
+focus click
+fullscreen pswm-fullscreen"
+"$CLIENT" -name pswm-fullscreen -T pswm-c >/dev/null 2>&1 &
+CLIENT_PIDS=$!
+WINDOW_C=$(xdotool search --sync --name "^pswm-c\$" | head -n 1)
+expect_focus "$WINDOW_C" "window mapped fullscreen"
+xdotool mousemove 400 300 click 1
+expect_focus "$WINDOW_C" "fullscreen window clicked"
+kill $CLIENT_PIDS
+end_session map "click focus" unmap
+
+[ "$failed" -eq 0 ] && echo "trace budgets: ok"
+exit "$failed"